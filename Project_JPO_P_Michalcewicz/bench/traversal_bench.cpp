@@ -0,0 +1,151 @@
+/*
+ * traversal_bench
+ * ---------------
+ * Times the traversal engines of FamilyTree (breadthFirst, preOrder,
+ * depthFirst) against hand-written loops that produce the same visiting
+ * order, on a random family tree with shared descendants. Every pair is
+ * checked for identical output. The two sides run alternately, seven times
+ * each, and the best time of each is shown.
+ * Build and run from this directory:
+ *     g++ -std=c++17 -O2 -pthread traversal_bench.cpp -o traversal_bench
+ *     ./traversal_bench [people]        (default 2000000)
+ */
+#define main familyTreeMain
+#include "../JPO_Project_PM.cpp"
+#undef main
+
+#include <chrono>
+#include <random>
+
+namespace {
+
+// Person i gets one or two parents among people 0 .. i-1
+void buildRandomTree(FamilyTree& tree, int count) {
+    std::mt19937 rng(1);
+    for (int i = 0; i < count; i++) {
+        int index = tree.addPerson("Person " + std::to_string(i), 1500 + static_cast<int>(rng() % 500));
+        if (i > 0) {
+            int first = static_cast<int>(rng() % i);
+            tree.connectParentChild(first, index);
+            int second = static_cast<int>(rng() % i);
+            if (rng() % 2 && second != first) tree.connectParentChild(second, index);
+        }
+    }
+}
+
+template <typename Run>
+double timed(Run& run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+    return took.count();
+}
+
+template <typename Engine, typename HandWritten>
+void compare(const char* what, Engine engine, HandWritten handWritten, const std::function<bool()>& same) {
+    double bestEngine = 1e300, bestHand = 1e300;
+    for (int k = 0; k < 7; k++) {
+        bestEngine = std::min(bestEngine, timed(engine));
+        bestHand = std::min(bestHand, timed(handWritten));
+    }
+    std::cout << what << ": engine " << bestEngine << " ms, hand-written " << bestHand << " ms"
+        << (same() ? "" : "  [OUTPUT DIFFERS]") << "\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int count = argc > 1 ? std::max(1, std::atoi(argv[1])) : 2000000;
+    FamilyTree tree(StartupMode::Empty);
+    buildRandomTree(tree, count);
+    std::cout << std::fixed << std::setprecision(1) << count << " people\n";
+
+    TraversalContext ctx;
+    std::vector<int> engineOrder, handOrder;
+    const Person* people = &tree.getPerson(0); // unchecked access for the hand-written loops
+
+    // Breadth-first from the first root, as the generation index walks
+    compare("breadthFirst", [&] {
+        engineOrder.clear();
+        ctx.begin(count);
+        tree.breadthFirst(0, ctx, [&](int index, int) { engineOrder.push_back(index); });
+    }, [&] {
+        handOrder.clear();
+        ctx.begin(count);
+        ctx.mark(0);
+        handOrder.push_back(0);
+        for (size_t head = 0; head < handOrder.size(); head++) {
+            for (int c : people[handOrder[head]].getChildren()) {
+                if (ctx.mark(c)) handOrder.push_back(c);
+            }
+        }
+    }, [&] { return engineOrder == handOrder; });
+
+    // Preorder over everyone, each Person once, as the DFS relabel walks
+    auto preOrderAll = [&](auto&& walkFrom) {
+        for (int i = 0; i < count; i++) walkFrom(i);
+    };
+    compare("preOrder", [&] {
+        engineOrder.clear();
+        ctx.begin(count);
+        preOrderAll([&](int start) {
+            tree.preOrder(start, ctx, [&](int index) { engineOrder.push_back(index); });
+        });
+    }, [&] {
+        handOrder.clear();
+        std::vector<char> placed(count, 0);
+        std::vector<int> stack;
+        preOrderAll([&](int start) {
+            stack.assign(1, start);
+            while (!stack.empty()) {
+                int curr = stack.back();
+                stack.pop_back();
+                if (placed[curr]) continue;
+                placed[curr] = 1;
+                handOrder.push_back(curr);
+                const ChildList& kids = people[curr].getChildren();
+                for (size_t k = kids.size(); k-- > 0;) stack.push_back(kids[k]);
+            }
+        });
+    }, [&] { return engineOrder == handOrder; });
+
+    // Enter and leave times from one root, as the interval index walks
+    std::vector<int> engineExit, handExit;
+    compare("depthFirst", [&] {
+        engineOrder.clear();
+        engineExit.clear();
+        ctx.begin(count);
+        tree.depthFirst(0, ctx,
+            [&](int index, int, bool) { engineOrder.push_back(index); },
+            [&](int index, int) { engineExit.push_back(index); });
+    }, [&] {
+        handOrder.clear();
+        handExit.clear();
+        ctx.begin(count);
+        struct Frame {
+            int person;
+            const int* next;
+            const int* end;
+        };
+        std::vector<Frame> frames;
+        auto enter = [&](int person) {
+            const ChildList& kids = people[person].getChildren();
+            handOrder.push_back(person);
+            frames.push_back({ person, kids.begin(), kids.end() });
+        };
+        ctx.mark(0);
+        enter(0);
+        while (!frames.empty()) {
+            Frame& top = frames.back();
+            if (top.next != top.end) {
+                int c = *top.next++;
+                if (ctx.mark(c)) enter(c);
+            }
+            else {
+                handExit.push_back(top.person);
+                frames.pop_back();
+            }
+        }
+    }, [&] { return engineOrder == handOrder && engineExit == handExit; });
+    return 0;
+}